@@ -1,6 +1,8 @@
 HEADERS += \
+    $$PWD/interfaces/MapSnapshot.h \
     $$PWD/interfaces/PipelineMapUpdateProcessing.h
 
 SOURCES += \
+    $$PWD/src/MapSnapshot.cpp \
     $$PWD/src/PipelineMapUpdateModule.cpp \
     $$PWD/src/PipelineMapUpdateProcessing.cpp
@@ -51,6 +51,7 @@ unix {
 
 linux {
         QMAKE_LFLAGS += -ldl
+        LIBS += -lrt # shared memory used by map snapshot
         LIBS += -L/home/linuxbrew/.linuxbrew/lib # temporary fix caused by grpc with -lre2 ... without -L in grpc.pc
 }
 
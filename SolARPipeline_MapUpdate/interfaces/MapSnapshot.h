@@ -0,0 +1,131 @@
+/**
+ * @copyright Copyright (c) 2020 B-com http://www.b-com.com/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAPSNAPSHOT_H
+#define MAPSNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "core/Messages.h"
+#include "datastructure/Map.h"
+
+namespace SolAR {
+namespace PIPELINES {
+
+    /**
+     * @class MapSnapshot
+     * @brief Global map snapshot stored in a named shared memory segment.
+     *
+     * A single writer process publishes serialized versions of the global map,
+     * and any number of local reader processes load the last published version.
+     * The segment starts with a sequence counter which is odd while the writer
+     * copies a new version, so that readers can detect and retry torn reads
+     * without any lock shared between processes.
+     * This protocol supports a single writer: the writer holds an exclusive
+     * file lock on the snapshot for its whole lifetime.
+     */
+    class MapSnapshot
+    {
+    public:
+        /// @brief MapSnapshot constructor
+        /// @param[in] name: the name of the shared memory segment
+        /// @param[in] maxSize: the maximum size (in bytes) of a serialized map
+        MapSnapshot(const std::string & name, uint64_t maxSize);
+
+        ~MapSnapshot();
+
+        /// @brief Create the shared memory segment (or reuse an existing one) to publish maps
+        /// @return FrameworkReturnCode::_SUCCESS if the segment is ready to be written, else FrameworkReturnCode::_ERROR_ (e.g. another writer already publishes to this snapshot)
+        FrameworkReturnCode create();
+
+        /// @brief Attach to the shared memory segment created by a writer
+        /// @return FrameworkReturnCode::_SUCCESS if the segment is ready to be read, else FrameworkReturnCode::_ERROR_
+        FrameworkReturnCode open();
+
+        /// @brief Remove the shared memory segment (writer only)
+        /// Readers still attached to the segment detect it with isClosed() and keep their last map
+        void remove();
+
+        /// @brief Detach from the shared memory segment
+        void close();
+
+        /// @brief Check if the shared memory segment is mapped in this process
+        bool isOpen() const;
+
+        /// @brief Check if the writer has removed the shared memory segment mapped in this process
+        bool isClosed() const;
+
+        /// @brief Check if the shared memory segment mapped in this process has been replaced by a new one
+        /// (e.g. removed manually after a writer crash, then created again by a new writer)
+        bool isReplaced();
+
+        /// @brief Get the version of the last map published in the shared memory segment
+        /// @return the version, 0 if no map has been published yet
+        uint64_t getVersion() const;
+
+        /// @brief Publish a new version of the map
+        /// @param[in] map: the map to publish
+        /// @return FrameworkReturnCode::_SUCCESS if the map is published, else FrameworkReturnCode::_ERROR_
+        FrameworkReturnCode publish(const SRef<datastructure::Map> map);
+
+        /// @brief Read the last published version of the map
+        /// @param[out] map: the output map, nullptr if no map has been published yet
+        /// @param[out] version: the version of the output map
+        /// @return FrameworkReturnCode::_SUCCESS if a consistent version has been read, else FrameworkReturnCode::_ERROR_
+        FrameworkReturnCode read(SRef<datastructure::Map> & map, uint64_t & version);
+
+    private:
+        /// @brief header placed at the beginning of the shared memory segment
+        struct Header {
+            std::atomic<uint64_t> sequence;     // even when stable, odd while writing (version = sequence / 2)
+            std::atomic<uint64_t> size;         // size of the serialized map, 0 if no map has been published
+            std::atomic<uint64_t> closed;       // 1 once the writer has removed the segment
+            std::atomic<uint64_t> generation;   // random id of the segment, 0 until set by its first writer
+        };
+
+        /// @brief take the exclusive writer lock of the snapshot
+        FrameworkReturnCode lockWriter();
+
+        /// @brief release the exclusive writer lock of the snapshot
+        void unlockWriter();
+
+        /// @brief map the shared memory segment in the address space of this process
+        FrameworkReturnCode mapRegion(boost::interprocess::mode_t mode);
+
+        Header * header() const;
+        char * payload() const;
+        uint64_t capacity() const;
+
+    private:
+        std::string                                             m_name;
+        uint64_t                                                m_maxSize;
+        std::unique_ptr<boost::interprocess::mapped_region>     m_region;
+        std::unique_ptr<boost::interprocess::file_lock>         m_writerLock;
+        mutable std::mutex                                      m_mutex;  // Mutex to protect snapshot access inside this process (m_region can be remapped by read)
+    };
+
+}
+}
+
+#endif // MAPSNAPSHOT_H
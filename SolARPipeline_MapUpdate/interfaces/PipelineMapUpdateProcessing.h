@@ -39,6 +39,7 @@
 #include "api/solver/map/IMapFusion.h"
 #include "api/solver/map/IMapUpdate.h"
 #include "api/storage/IMapManager.h"
+#include "MapSnapshot.h"
 
 namespace SolAR {
 namespace PIPELINES {
@@ -56,6 +57,30 @@ namespace PIPELINES {
 	 * @SolARComponentInjectable{SolAR::api::solver::map::IBundler}
      * @SolARComponentInjectablesEnd
      *
+     * @SolARComponentPropertiesBegin
+     * @SolARComponentProperty{ nbKeyframeSubmap,
+     *                          number of keyframes of a submap,
+     *                          @SolARComponentPropertyDescNum{ int, [0..MAX INT], 100 }}
+     * @SolARComponentProperty{ snapshotMode,
+     *                          "none": standalone pipeline<br>
+     *                          "writer": publish each committed global map to a shared memory snapshot<br>
+     *                          "replica": read-only pipeline serving requests from the snapshot published by a writer,
+     *                          @SolARComponentPropertyDescString{ "none" }}
+     * @SolARComponentProperty{ snapshotName,
+     *                          name of the shared memory snapshot (must be the same for the writer and its replicas),
+     *                          @SolARComponentPropertyDescString{ "SolARMapUpdateSnapshot" }}
+     * @SolARComponentProperty{ snapshotMaxSize,
+     *                          maximum size in MB of a serialized global map published by the writer,
+     *                          @SolARComponentPropertyDescNum{ int, [1..MAX INT], 1024 }}
+     * @SolARComponentProperty{ snapshotRemoveOnExit,
+     *                          1 to remove the shared memory snapshot when the writer is destroyed<br>
+     *                          0 to keep it (replicas then keep serving the last published map),
+     *                          @SolARComponentPropertyDescNum{ int, [0..1], 1 }}
+     * @SolARComponentProperty{ snapshotPollPeriod,
+     *                          period in ms used by a replica to check for a new map version,
+     *                          @SolARComponentPropertyDescNum{ int, [1..MAX INT], 500 }}
+     * @SolARComponentPropertiesEnd
+     *
      */
 
     class SOLARPIPELINE_MAPUPDATE_EXPORT_API PipelineMapUpdateProcessing : public org::bcom::xpcf::ConfigurableBase,
@@ -67,6 +92,9 @@ namespace PIPELINES {
 
         void unloadComponent() override final {}
 
+        /// @brief Check the snapshot properties once the component is configured
+        org::bcom::xpcf::XPCFErrorCode onConfigured() override final;
+
         /// @brief Initialization of the pipeline
         /// @return FrameworkReturnCode::_SUCCESS if the init succeed, else
         FrameworkReturnCode init() override;
@@ -114,11 +142,31 @@ namespace PIPELINES {
 		/// @brief method that implementes the full maping processing
 		void processMapUpdate();
 
+        /// @brief method that loads the last map version published in the snapshot (replica mode)
+        void processSnapshotUpdate();
+
+        /// @brief publish a committed global map to the snapshot (writer mode)
+        /// must be called with m_process_mutex held so that versions are published in commit order
+        /// @return FrameworkReturnCode::_SUCCESS if the map is published (or if the pipeline is not a writer), else FrameworkReturnCode::_ERROR_
+        FrameworkReturnCode publishSnapshot(const SRef<datastructure::Map> map);
+
     private:
         bool										m_init = false;
         bool                                        m_emptyMap = false;
 		int											m_nbKeyframeSubmap = 100;
 
+        // Global map snapshot shared with replica processes
+        enum class SnapshotMode { NONE, WRITER, REPLICA };
+        std::string                                 m_snapshotModeName = "none";
+        std::string                                 m_snapshotName = "SolARMapUpdateSnapshot";
+        int                                         m_snapshotMaxSize = 1024;
+        int                                         m_snapshotPollPeriod = 500;
+        int                                         m_snapshotRemoveOnExit = 1;
+        SnapshotMode                                m_snapshotMode = SnapshotMode::NONE;
+        uint64_t                                    m_snapshotVersion = 0;
+        uint64_t                                    m_snapshotFailedVersion = 0;
+        std::unique_ptr<MapSnapshot>                m_mapSnapshot;
+
         mutable std::mutex							m_map_mutex;      // Mutex to protect map access
         mutable std::mutex							m_process_mutex;  // Mutex to protect map processing
 
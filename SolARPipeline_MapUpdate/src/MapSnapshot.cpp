@@ -0,0 +1,385 @@
+/**
+ * @copyright Copyright (c) 2020 All Right Reserved, B-com http://www.b-com.com/
+ *
+ * This file is subject to the B<>Com License.
+ * All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ * KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ * PARTICULAR PURPOSE.
+ *
+ */
+
+#include "MapSnapshot.h"
+#include "core/Log.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <thread>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/stream.hpp>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
+
+namespace xpcf  = org::bcom::xpcf;
+namespace bip   = boost::interprocess;
+
+namespace SolAR {
+using namespace datastructure;
+namespace PIPELINES {
+
+// Header atomics are shared between processes: they must not rely on a process local lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "MapSnapshot requires lock-free 64 bits atomics");
+
+// Number of attempts to read a consistent version while the writer is publishing
+static const int NB_READ_ATTEMPTS = 10;
+
+// File locks are owned by a process: snapshots written by this process are also tracked locally
+static std::mutex s_writersMutex;
+static std::set<std::string> s_writers;
+
+MapSnapshot::MapSnapshot(const std::string & name, uint64_t maxSize): m_name(name), m_maxSize(maxSize)
+{
+}
+
+MapSnapshot::~MapSnapshot()
+{
+    unlockWriter();
+}
+
+FrameworkReturnCode MapSnapshot::create()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (lockWriter() != FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Map snapshot {} is already published by another writer", m_name);
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    try {
+        // Reuse an existing segment so that attached readers keep on seeing new versions after a writer restart
+        bip::shared_memory_object shm(bip::open_or_create, m_name.c_str(), bip::read_write);
+        bip::offset_t size = 0;
+        shm.get_size(size);
+        if (static_cast<uint64_t>(size) < sizeof(Header) + m_maxSize)
+            shm.truncate(sizeof(Header) + m_maxSize);
+#if defined(__linux__)
+        // Reserve the memory of the whole segment: the shared memory file system (/dev/shm) could be too small,
+        // which would only be detected by a SIGBUS when a large map is copied into the segment
+        int error = posix_fallocate(shm.get_mapping_handle().handle, 0, sizeof(Header) + m_maxSize);
+        if (error != 0) {
+            LOG_ERROR("Cannot reserve {} bytes of shared memory for map snapshot {}: {}", sizeof(Header) + m_maxSize, m_name, std::strerror(error));
+            if (size == 0)
+                bip::shared_memory_object::remove(m_name.c_str());
+            unlockWriter();
+            return FrameworkReturnCode::_ERROR_;
+        }
+#endif
+    }
+    catch (const bip::interprocess_exception & e) {
+        LOG_ERROR("Cannot create map snapshot {}: {}", m_name, e.what());
+        unlockWriter();
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    if (mapRegion(bip::read_write) != FrameworkReturnCode::_SUCCESS) {
+        unlockWriter();
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    header()->closed.store(0, std::memory_order_relaxed);
+
+    // Identify a new segment, so that readers attached to a previous one removed manually can detect it
+    if (header()->generation.load(std::memory_order_relaxed) == 0) {
+        std::random_device randomDevice;
+        std::mt19937_64 generator((static_cast<uint64_t>(randomDevice()) << 32) ^ randomDevice());
+        uint64_t generation = 0;
+        while (generation == 0)
+            generation = generator();
+        header()->generation.store(generation, std::memory_order_release);
+    }
+
+    // A previous writer stopped while publishing: invalidate its partial version
+    uint64_t sequence = header()->sequence.load(std::memory_order_relaxed);
+    if (sequence & 1) {
+        header()->size.store(0, std::memory_order_relaxed);
+        header()->sequence.store(sequence + 1, std::memory_order_release);
+    }
+
+    LOG_INFO("Map snapshot {} created (version {})", m_name, header()->sequence.load(std::memory_order_acquire) / 2);
+
+    return FrameworkReturnCode::_SUCCESS;
+}
+
+FrameworkReturnCode MapSnapshot::open()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return mapRegion(bip::read_only);
+}
+
+void MapSnapshot::remove()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_writerLock == nullptr) {
+        LOG_WARNING("Map snapshot {} can only be removed by its writer", m_name);
+        return;
+    }
+
+    // Notify attached readers before unlinking: they could not see the versions of a new segment
+    if (m_region != nullptr) {
+        header()->closed.store(1, std::memory_order_release);
+        m_region.reset();
+    }
+    bip::shared_memory_object::remove(m_name.c_str());
+
+    LOG_INFO("Map snapshot {} removed", m_name);
+}
+
+void MapSnapshot::close()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_region.reset();
+}
+
+bool MapSnapshot::isOpen() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return m_region != nullptr;
+}
+
+bool MapSnapshot::isClosed() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return m_region != nullptr && header()->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool MapSnapshot::isReplaced()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_region == nullptr)
+        return false;
+
+    try {
+        bip::shared_memory_object shm(bip::open_only, m_name.c_str(), bip::read_only);
+        bip::offset_t size = 0;
+        shm.get_size(size);
+        if (static_cast<uint64_t>(size) < sizeof(Header))
+            return false;
+        bip::mapped_region region(shm, bip::read_only, 0, sizeof(Header));
+        uint64_t generation = static_cast<Header *>(region.get_address())->generation.load(std::memory_order_acquire);
+        return generation != 0 && generation != header()->generation.load(std::memory_order_acquire);
+    }
+    catch (const bip::interprocess_exception &) {
+        // No segment: keep the mapped one until a new writer creates a segment
+        return false;
+    }
+}
+
+uint64_t MapSnapshot::getVersion() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_region == nullptr)
+        return 0;
+
+    return header()->sequence.load(std::memory_order_acquire) / 2;
+}
+
+FrameworkReturnCode MapSnapshot::publish(const SRef<Map> map)
+{
+    if (map == nullptr)
+        return FrameworkReturnCode::_ERROR_;
+
+    // Serialize outside of the shared memory segment to keep the publishing window short
+    // (directly into the buffer to copy: maps can be large)
+    std::string data;
+    try {
+        boost::iostreams::stream<boost::iostreams::back_insert_device<std::string>> os(data);
+        {
+            boost::archive::binary_oarchive oa(os);
+            oa << *map;
+        }
+        os.flush();
+    }
+    catch (const std::exception & e) {
+        LOG_ERROR("Cannot serialize map for snapshot {}: {}", m_name, e.what());
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_region == nullptr) {
+        LOG_WARNING("Map snapshot {} has not been created", m_name);
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    if (data.size() > capacity()) {
+        LOG_WARNING("Map snapshot {} too small ({} bytes) for a map of {} bytes", m_name, capacity(), data.size());
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    Header * h = header();
+    uint64_t sequence = h->sequence.load(std::memory_order_relaxed);
+    h->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(payload(), data.data(), data.size());
+    h->size.store(data.size(), std::memory_order_relaxed);
+    h->sequence.store(sequence + 2, std::memory_order_release);
+
+    LOG_DEBUG("Map snapshot {} published version {} ({} bytes)", m_name, (sequence + 2) / 2, data.size());
+
+    return FrameworkReturnCode::_SUCCESS;
+}
+
+FrameworkReturnCode MapSnapshot::read(SRef<Map> & map, uint64_t & version)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_region == nullptr)
+        return FrameworkReturnCode::_ERROR_;
+
+    std::string data;
+    bool consistent = false;
+    for (int i = 0; !consistent && i < NB_READ_ATTEMPTS; ++i) {
+        Header * h = header();
+        uint64_t sequence = h->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        uint64_t size = h->size.load(std::memory_order_relaxed);
+        if (size > capacity()) {
+            // The writer has enlarged the segment since it was mapped
+            if (mapRegion(bip::read_only) != FrameworkReturnCode::_SUCCESS)
+                return FrameworkReturnCode::_ERROR_;
+            continue;
+        }
+        data.assign(payload(), size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (h->sequence.load(std::memory_order_relaxed) == sequence) {
+            version = sequence / 2;
+            consistent = true;
+        }
+    }
+
+    if (!consistent) {
+        LOG_DEBUG("Map snapshot {} is being published, read postponed", m_name);
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    lock.unlock();
+
+    if (data.empty()) {
+        map = nullptr;
+        return FrameworkReturnCode::_SUCCESS;
+    }
+
+    SRef<Map> snapshotMap = xpcf::utils::make_shared<Map>();
+    try {
+        // Deserialize from the copied buffer without copying it again
+        boost::iostreams::stream<boost::iostreams::array_source> is(data.data(), data.size());
+        boost::archive::binary_iarchive ia(is);
+        ia >> *snapshotMap;
+    }
+    catch (const std::exception & e) {
+        LOG_ERROR("Cannot deserialize map version {} from snapshot {}: {}", version, m_name, e.what());
+        return FrameworkReturnCode::_ERROR_;
+    }
+    map = snapshotMap;
+
+    return FrameworkReturnCode::_SUCCESS;
+}
+
+FrameworkReturnCode MapSnapshot::lockWriter()
+{
+    if (m_writerLock != nullptr)
+        return FrameworkReturnCode::_SUCCESS;
+
+    std::unique_lock<std::mutex> lock(s_writersMutex);
+
+    if (s_writers.count(m_name) > 0)
+        return FrameworkReturnCode::_ERROR_;
+
+    // The lock is released by the system if the writer process stops unexpectedly
+    std::string lockPath = (std::filesystem::temp_directory_path() / (m_name + ".lock")).string();
+    try {
+        std::ofstream(lockPath, std::ios::app);
+        auto writerLock = std::make_unique<bip::file_lock>(lockPath.c_str());
+        if (!writerLock->try_lock())
+            return FrameworkReturnCode::_ERROR_;
+        m_writerLock = std::move(writerLock);
+    }
+    catch (const bip::interprocess_exception & e) {
+        LOG_ERROR("Cannot lock map snapshot {} with {}: {}", m_name, lockPath, e.what());
+        return FrameworkReturnCode::_ERROR_;
+    }
+    s_writers.insert(m_name);
+
+    return FrameworkReturnCode::_SUCCESS;
+}
+
+void MapSnapshot::unlockWriter()
+{
+    if (m_writerLock == nullptr)
+        return;
+
+    std::unique_lock<std::mutex> lock(s_writersMutex);
+
+    m_writerLock->unlock();
+    m_writerLock.reset();
+    s_writers.erase(m_name);
+}
+
+FrameworkReturnCode MapSnapshot::mapRegion(bip::mode_t mode)
+{
+    try {
+        bip::shared_memory_object shm(bip::open_only, m_name.c_str(), mode);
+        m_region = std::make_unique<bip::mapped_region>(shm, mode);
+    }
+    catch (const bip::interprocess_exception & e) {
+        LOG_DEBUG("Cannot map snapshot {}: {}", m_name, e.what());
+        m_region.reset();
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    if (m_region->get_size() < sizeof(Header)) {
+        m_region.reset();
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    return FrameworkReturnCode::_SUCCESS;
+}
+
+MapSnapshot::Header * MapSnapshot::header() const
+{
+    return static_cast<Header *>(m_region->get_address());
+}
+
+char * MapSnapshot::payload() const
+{
+    return static_cast<char *>(m_region->get_address()) + sizeof(Header);
+}
+
+uint64_t MapSnapshot::capacity() const
+{
+    return m_region->get_size() - sizeof(Header);
+}
+
+}
+}
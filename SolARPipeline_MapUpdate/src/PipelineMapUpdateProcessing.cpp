@@ -14,6 +14,9 @@
 #include "PipelineMapUpdateProcessing.h"
 #include "core/Log.h"
 
+#include <chrono>
+#include <thread>
+
 namespace xpcf  = org::bcom::xpcf;
 
 namespace SolAR {
@@ -31,12 +34,20 @@ PipelineMapUpdateProcessing::PipelineMapUpdateProcessing():ConfigurableBase(xpcf
 	declareInjectable<api::reloc::IKeyframeRetriever>(m_kfRetriever);
     declareInjectable<api::geom::I3DTransform>(m_transform3D);
 	declareProperty("nbKeyframeSubmap", m_nbKeyframeSubmap);
+    declareProperty("snapshotMode", m_snapshotModeName);
+    declareProperty("snapshotName", m_snapshotName);
+    declareProperty("snapshotMaxSize", m_snapshotMaxSize);
+    declareProperty("snapshotPollPeriod", m_snapshotPollPeriod);
+    declareProperty("snapshotRemoveOnExit", m_snapshotRemoveOnExit);
 	LOG_DEBUG("PipelineMapUpdateProcessing constructor");
 
     // create map update thread
     if (m_mapUpdateTask == nullptr) {
         auto fnMapUpdateProcessing = [&]() {
-            processMapUpdate();
+            if (m_snapshotMode == SnapshotMode::REPLICA)
+                processSnapshotUpdate();
+            else
+                processMapUpdate();
         };
 
         m_mapUpdateTask = new xpcf::DelegateTask(fnMapUpdateProcessing);
@@ -52,6 +63,9 @@ PipelineMapUpdateProcessing::~PipelineMapUpdateProcessing()
         delete m_mapUpdateTask;
     }
 
+    if (m_snapshotMode == SnapshotMode::WRITER && m_mapSnapshot != nullptr && m_snapshotRemoveOnExit)
+        m_mapSnapshot->remove();
+
     std::unique_lock<std::mutex> lock(m_map_mutex);
 
     LOG_DEBUG("Remove map data from memory");
@@ -60,22 +74,78 @@ PipelineMapUpdateProcessing::~PipelineMapUpdateProcessing()
     m_mapManager->setMap(xpcf::utils::make_shared<Map>());
 }
 
+xpcf::XPCFErrorCode PipelineMapUpdateProcessing::onConfigured()
+{
+    LOG_DEBUG("PipelineMapUpdateProcessing onConfigured");
+
+    // Check all the properties before switching mode: a failed configuration leaves a standalone pipeline
+    SnapshotMode snapshotMode;
+    if (m_snapshotModeName == "none")
+        snapshotMode = SnapshotMode::NONE;
+    else if (m_snapshotModeName == "writer")
+        snapshotMode = SnapshotMode::WRITER;
+    else if (m_snapshotModeName == "replica")
+        snapshotMode = SnapshotMode::REPLICA;
+    else {
+        LOG_ERROR("Unknown snapshot mode: {} (expected none, writer or replica)", m_snapshotModeName);
+        return xpcf::XPCFErrorCode::_FAIL;
+    }
+
+    if (m_snapshotMaxSize <= 0 || m_snapshotPollPeriod <= 0) {
+        LOG_ERROR("Snapshot max size and poll period must be positive");
+        return xpcf::XPCFErrorCode::_FAIL;
+    }
+
+    if (snapshotMode != SnapshotMode::NONE)
+        m_mapSnapshot = std::make_unique<MapSnapshot>(m_snapshotName, static_cast<uint64_t>(m_snapshotMaxSize) * 1024 * 1024);
+    m_snapshotMode = snapshotMode;
+
+    return xpcf::XPCFErrorCode::_SUCCESS;
+}
+
 FrameworkReturnCode PipelineMapUpdateProcessing::init()
 {
     LOG_DEBUG("PipelineMapUpdateProcessing init");
 
     if (!m_init) {
 
+        if (m_snapshotMode != SnapshotMode::NONE && m_mapSnapshot == nullptr) {
+            LOG_ERROR("Map snapshot {} not configured", m_snapshotName);
+            return FrameworkReturnCode::_ERROR_;
+        }
+
         std::unique_lock<std::mutex> lock(m_map_mutex);
 
+        if (m_snapshotMode == SnapshotMode::REPLICA) {
+            // Global map is loaded from the snapshot by the map update thread
+            if (m_mapSnapshot->open() != FrameworkReturnCode::_SUCCESS)
+                LOG_INFO("Map snapshot {} not available yet, wait for writer", m_snapshotName);
+            m_emptyMap = true;
+        }
         // Load current map from file
-        if (m_mapManager->loadFromFile() == FrameworkReturnCode::_ERROR_) {
+        else if (m_mapManager->loadFromFile() == FrameworkReturnCode::_ERROR_) {
             LOG_INFO("Initialize global map from scratch");
             m_emptyMap = true;
         }
         else
             m_emptyMap = false;
 
+        if (m_snapshotMode == SnapshotMode::WRITER) {
+            if (m_mapSnapshot->create() != FrameworkReturnCode::_SUCCESS) {
+                LOG_ERROR("Cannot create map snapshot {}", m_snapshotName);
+                return FrameworkReturnCode::_ERROR_;
+            }
+            SRef<Map> map;
+            m_mapManager->getMap(map);
+            lock.unlock();
+            // Replicas must not serve a stale map: a global map larger than the snapshot is a configuration error
+            if (publishSnapshot(m_emptyMap ? xpcf::utils::make_shared<Map>() : map) != FrameworkReturnCode::_SUCCESS) {
+                LOG_ERROR("Cannot publish global map to snapshot {}, check snapshotMaxSize", m_snapshotName);
+                return FrameworkReturnCode::_ERROR_;
+            }
+            lock.lock();
+        }
+
         // start map update thread
         if (m_mapUpdateTask != nullptr)
             m_mapUpdateTask->start();
@@ -125,6 +195,12 @@ FrameworkReturnCode PipelineMapUpdateProcessing::mapUpdateRequest(const SRef<dat
         return FrameworkReturnCode::_ERROR_;
     }
 
+    if (m_snapshotMode == SnapshotMode::REPLICA)
+    {
+        LOG_WARNING("Map update request not allowed on a read-only replica pipeline");
+        return FrameworkReturnCode::_ERROR_;
+    }
+
 	m_inputMapBuffer.push(map);
 
 	return FrameworkReturnCode::_SUCCESS;
@@ -157,13 +233,13 @@ FrameworkReturnCode PipelineMapUpdateProcessing::getSubmapRequest(const SRef<Sol
         return FrameworkReturnCode::_ERROR_;
     }
 
-    // keyframes retrieval
+    // keyframes retrieval and submap use the same map version (the map can be replaced by a reset or a replica update)
+    std::unique_lock<std::mutex> lock(m_map_mutex);
+
 	std::vector <uint32_t> retKeyframesId;
 
 	if (m_kfRetriever->retrieve(frame, retKeyframesId) == FrameworkReturnCode::_SUCCESS) {
 
-        std::unique_lock<std::mutex> lock(m_map_mutex);
-
         // get submap
 		m_mapManager->getSubmap(retKeyframesId[0], m_nbKeyframeSubmap, map);
 
@@ -177,6 +253,15 @@ FrameworkReturnCode PipelineMapUpdateProcessing::resetMap()
 {
     LOG_DEBUG("PipelineMapUpdateProcessing resetMap");
 
+    if (m_snapshotMode == SnapshotMode::REPLICA)
+    {
+        LOG_WARNING("Map reset not allowed on a read-only replica pipeline");
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    // Wait for the current map processing so that snapshots are published in commit order
+    std::unique_lock<std::mutex> lock_process(m_process_mutex);
+
     std::unique_lock<std::mutex> lock(m_map_mutex);
 
     if (m_mapManager->deleteFile() == FrameworkReturnCode::_SUCCESS) {
@@ -186,6 +271,11 @@ FrameworkReturnCode PipelineMapUpdateProcessing::resetMap()
 
         m_emptyMap = true;
 
+        lock.unlock();
+
+        // Replicas also unload their map
+        publishSnapshot(xpcf::utils::make_shared<Map>());
+
         LOG_INFO("Map reset ok");
 
         return FrameworkReturnCode::_SUCCESS;
@@ -244,6 +334,10 @@ void PipelineMapUpdateProcessing::processMapUpdate()
         m_mapManager->saveToFile();
         m_emptyMap = false;
 
+        lock_map.unlock();
+
+        publishSnapshot(map);
+
         return;
     }
 
@@ -323,6 +417,75 @@ void PipelineMapUpdateProcessing::processMapUpdate()
 	m_mapManager->pointCloudPruning();
 	m_mapManager->keyframePruning();
 	m_mapManager->saveToFile();
+
+    lock_map.unlock();
+
+    publishSnapshot(current_map);
+}
+
+void PipelineMapUpdateProcessing::processSnapshotUpdate()
+{
+    if (!m_init) {
+        xpcf::DelegateTask::yield();
+        return;
+    }
+
+    // The writer has removed the snapshot, or it has been replaced: keep the current map until a new writer publishes a new one
+    if (m_mapSnapshot->isClosed() || m_mapSnapshot->isReplaced()) {
+        LOG_INFO("Map snapshot {} removed or replaced, wait for a new writer", m_snapshotName);
+        m_mapSnapshot->close();
+        m_snapshotVersion = 0;
+        m_snapshotFailedVersion = 0;
+    }
+
+    // Attach to the snapshot if the writer was not started at initialization, then check for a new version
+    if (!m_mapSnapshot->isOpen() && m_mapSnapshot->open() != FrameworkReturnCode::_SUCCESS) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_snapshotPollPeriod));
+        return;
+    }
+    uint64_t lastVersion = m_mapSnapshot->getVersion();
+    if (lastVersion == m_snapshotVersion || lastVersion == m_snapshotFailedVersion) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_snapshotPollPeriod));
+        return;
+    }
+
+    // Deserialize outside of the map lock so that requests are still served with the previous version
+    SRef<Map> map;
+    uint64_t version;
+    if (m_mapSnapshot->read(map, version) != FrameworkReturnCode::_SUCCESS) {
+        // Do not read this version again: wait for the writer to publish a new one
+        LOG_WARNING("Cannot read version {} of map snapshot {}", lastVersion, m_snapshotName);
+        m_snapshotFailedVersion = lastVersion;
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_snapshotPollPeriod));
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_map_mutex);
+
+    if (map == nullptr || map->getConstKeyframeCollection()->getNbKeyframes() == 0) {
+        m_mapManager->setMap(xpcf::utils::make_shared<Map>());
+        m_emptyMap = true;
+    }
+    else {
+        m_mapManager->setMap(map);
+        m_emptyMap = false;
+    }
+    m_snapshotVersion = version;
+
+    LOG_INFO("Global map updated from snapshot {} (version {})", m_snapshotName, version);
+}
+
+FrameworkReturnCode PipelineMapUpdateProcessing::publishSnapshot(const SRef<Map> map)
+{
+    if (m_snapshotMode != SnapshotMode::WRITER)
+        return FrameworkReturnCode::_SUCCESS;
+
+    if (m_mapSnapshot->publish(map) != FrameworkReturnCode::_SUCCESS) {
+        LOG_WARNING("Cannot publish global map to snapshot {}", m_snapshotName);
+        return FrameworkReturnCode::_ERROR_;
+    }
+
+    return FrameworkReturnCode::_SUCCESS;
 }
 
 }
@@ -0,0 +1,289 @@
+/**
+ * @copyright Copyright (c) 2020 All Right Reserved, B-com http://www.b-com.com/
+ *
+ * This file is subject to the B<>Com License.
+ * All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ * KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ * PARTICULAR PURPOSE.
+ *
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "core/Log.h"
+#include "MapSnapshot.h"
+
+using namespace SolAR;
+using namespace SolAR::datastructure;
+using namespace SolAR::PIPELINES;
+namespace xpcf = org::bcom::xpcf;
+namespace bip = boost::interprocess;
+
+/* This sample is to test the shared memory map snapshot used by writer and replica map update pipelines.
+*  It checks an empty snapshot, reads concurrent to publications (torn reads), the recovery from a writer
+*  stopped while publishing, the remapping of a snapshot enlarged by a new writer and the detection of a snapshot
+*  removed manually then created again.
+*/
+
+static const char * SNAPSHOT_NAME = "SolARPipelineTest_MapSnapshot";
+static const uint64_t SNAPSHOT_SIZE = 1024 * 1024;
+static const int NB_PUBLICATIONS = 2000;
+
+// Maps are identified by the x translation of their transform
+static SRef<Map> createMap(float id)
+{
+    SRef<Map> map = xpcf::utils::make_shared<Map>();
+    Transform3Df transform = Transform3Df::Identity();
+    transform.translation().x() = id;
+    map->setTransform3D(transform);
+    return map;
+}
+
+static float getMapId(const SRef<Map> & map)
+{
+    return map->getTransform3D().translation().x();
+}
+
+static bool testEmptySnapshot()
+{
+    MapSnapshot writer(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    MapSnapshot reader(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+
+    if (reader.open() == FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Reader attached to a snapshot not created yet");
+        return false;
+    }
+    if (writer.create() != FrameworkReturnCode::_SUCCESS || reader.open() != FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Cannot create and open snapshot");
+        return false;
+    }
+
+    // Nothing published yet
+    SRef<Map> map;
+    uint64_t version = 1;
+    if (reader.getVersion() != 0 || reader.read(map, version) != FrameworkReturnCode::_SUCCESS || map != nullptr || version != 0) {
+        LOG_ERROR("Unexpected map read from a snapshot without publication");
+        return false;
+    }
+
+    // Empty map
+    if (writer.publish(xpcf::utils::make_shared<Map>()) != FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Cannot publish an empty map");
+        return false;
+    }
+    if (reader.getVersion() != 1 || reader.read(map, version) != FrameworkReturnCode::_SUCCESS || map == nullptr
+        || version != 1 || map->getConstKeyframeCollection()->getNbKeyframes() != 0) {
+        LOG_ERROR("Cannot read the empty map");
+        return false;
+    }
+
+    // Removal seen by the reader
+    writer.remove();
+    if (!reader.isClosed()) {
+        LOG_ERROR("Reader has not detected the snapshot removal");
+        return false;
+    }
+
+    return true;
+}
+
+static bool testTornRead()
+{
+    MapSnapshot writer(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    MapSnapshot reader(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    if (writer.create() != FrameworkReturnCode::_SUCCESS || reader.open() != FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Cannot create and open snapshot");
+        return false;
+    }
+    uint64_t baseVersion = writer.getVersion();
+
+    std::atomic<bool> stop(false);
+    std::thread publisher([&]() {
+        for (int i = 1; i <= NB_PUBLICATIONS; ++i)
+            writer.publish(createMap(static_cast<float>(i)));
+        stop = true;
+    });
+
+    // Each consistent read must return the map published with its version
+    // (reads overlapping a publication depend on timing: a torn read is detected only if it occurs)
+    int nbConsistentReads = 0;
+    int nbPostponedReads = 0;
+    bool inconsistent = false;
+    while (!stop) {
+        SRef<Map> map;
+        uint64_t version;
+        if (reader.read(map, version) != FrameworkReturnCode::_SUCCESS)
+            ++nbPostponedReads;
+        else if (map == nullptr)
+            continue;
+        else if (getMapId(map) != static_cast<float>(version - baseVersion)) {
+            LOG_ERROR("Map {} read with version {}", getMapId(map), version - baseVersion);
+            inconsistent = true;
+        }
+        else
+            ++nbConsistentReads;
+    }
+    publisher.join();
+    LOG_INFO("{} consistent reads, {} postponed reads during {} publications", nbConsistentReads, nbPostponedReads, NB_PUBLICATIONS);
+
+    writer.remove();
+
+    return !inconsistent && nbConsistentReads > 0;
+}
+
+static bool testWriterCrash()
+{
+    MapSnapshot reader(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    {
+        MapSnapshot writer(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+        if (writer.create() != FrameworkReturnCode::_SUCCESS || writer.publish(createMap(1.f)) != FrameworkReturnCode::_SUCCESS) {
+            LOG_ERROR("Cannot publish map");
+            return false;
+        }
+
+        // Writer stopped while publishing: the sequence counter (first field of the snapshot header) stays odd
+        bip::shared_memory_object shm(bip::open_only, SNAPSHOT_NAME, bip::read_write);
+        bip::mapped_region region(shm, bip::read_write);
+        static_cast<std::atomic<uint64_t> *>(region.get_address())->fetch_add(1);
+    }
+
+    SRef<Map> map;
+    uint64_t version;
+    if (reader.open() != FrameworkReturnCode::_SUCCESS || reader.read(map, version) == FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Partial version read");
+        return false;
+    }
+
+    // A new writer invalidates the partial version then publishes again
+    MapSnapshot writer(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    if (writer.create() != FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Cannot create snapshot after writer crash");
+        return false;
+    }
+    if (reader.read(map, version) != FrameworkReturnCode::_SUCCESS || map != nullptr || version != 2) {
+        LOG_ERROR("Partial version not invalidated");
+        return false;
+    }
+    if (writer.publish(createMap(3.f)) != FrameworkReturnCode::_SUCCESS
+        || reader.read(map, version) != FrameworkReturnCode::_SUCCESS || map == nullptr || getMapId(map) != 3.f) {
+        LOG_ERROR("Cannot read map published after writer crash");
+        return false;
+    }
+
+    writer.remove();
+
+    return true;
+}
+
+static bool testSegmentReplaced()
+{
+    MapSnapshot reader(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    {
+        // Writer stopped without removing its snapshot, which is then removed manually
+        MapSnapshot writer(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+        if (writer.create() != FrameworkReturnCode::_SUCCESS || writer.publish(createMap(1.f)) != FrameworkReturnCode::_SUCCESS
+            || reader.open() != FrameworkReturnCode::_SUCCESS) {
+            LOG_ERROR("Cannot create and open snapshot");
+            return false;
+        }
+    }
+    if (reader.isReplaced()) {
+        LOG_ERROR("Snapshot replaced before removal");
+        return false;
+    }
+    bip::shared_memory_object::remove(SNAPSHOT_NAME);
+    if (reader.isReplaced()) {
+        LOG_ERROR("Snapshot replaced without new writer");
+        return false;
+    }
+
+    // A new writer creates a new snapshot: the reader must attach to it
+    MapSnapshot writer(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    if (writer.create() != FrameworkReturnCode::_SUCCESS || writer.publish(createMap(2.f)) != FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Cannot publish map in new snapshot");
+        return false;
+    }
+    if (!reader.isReplaced()) {
+        LOG_ERROR("Reader has not detected the new snapshot");
+        return false;
+    }
+    reader.close();
+    SRef<Map> map;
+    uint64_t version;
+    if (reader.open() != FrameworkReturnCode::_SUCCESS || reader.read(map, version) != FrameworkReturnCode::_SUCCESS
+        || map == nullptr || getMapId(map) != 2.f) {
+        LOG_ERROR("Cannot read map from new snapshot");
+        return false;
+    }
+
+    writer.remove();
+
+    return true;
+}
+
+static bool testSegmentGrowth()
+{
+    MapSnapshot reader(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    {
+        MapSnapshot smallWriter(SNAPSHOT_NAME, 1);
+        if (smallWriter.create() != FrameworkReturnCode::_SUCCESS || reader.open() != FrameworkReturnCode::_SUCCESS) {
+            LOG_ERROR("Cannot create and open snapshot");
+            return false;
+        }
+        if (smallWriter.publish(createMap(1.f)) == FrameworkReturnCode::_SUCCESS) {
+            LOG_ERROR("Map published in a too small snapshot");
+            return false;
+        }
+    }
+
+    // A new writer enlarges the snapshot already mapped by the reader
+    MapSnapshot writer(SNAPSHOT_NAME, SNAPSHOT_SIZE);
+    if (writer.create() != FrameworkReturnCode::_SUCCESS || writer.publish(createMap(2.f)) != FrameworkReturnCode::_SUCCESS) {
+        LOG_ERROR("Cannot publish map in enlarged snapshot");
+        return false;
+    }
+    SRef<Map> map;
+    uint64_t version;
+    if (reader.read(map, version) != FrameworkReturnCode::_SUCCESS || map == nullptr || getMapId(map) != 2.f) {
+        LOG_ERROR("Cannot read map from enlarged snapshot");
+        return false;
+    }
+
+    writer.remove();
+
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    LOG_ADD_LOG_TO_CONSOLE();
+
+    // Remove a snapshot left by a previous failed run
+    bip::shared_memory_object::remove(SNAPSHOT_NAME);
+
+    bool success = true;
+    auto runTest = [&success](const std::string & name, bool (*test)()) {
+        if (test())
+            LOG_INFO("{}: passed", name);
+        else {
+            LOG_ERROR("{}: failed", name);
+            success = false;
+        }
+    };
+
+    runTest("Empty snapshot", testEmptySnapshot);
+    runTest("Torn read", testTornRead);
+    runTest("Writer crash", testWriterCrash);
+    runTest("Segment growth", testSegmentGrowth);
+    runTest("Segment replaced", testSegmentReplaced);
+
+    bip::shared_memory_object::remove(SNAPSHOT_NAME);
+
+    return success ? 0 : -1;
+}
@@ -0,0 +1,116 @@
+/**
+ * @copyright Copyright (c) 2020 All Right Reserved, B-com http://www.b-com.com/
+ *
+ * This file is subject to the B<>Com License.
+ * All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+ * KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+ * PARTICULAR PURPOSE.
+ *
+ */
+
+#include <iostream>
+#include <chrono>
+#include <boost/log/core.hpp>
+#include <xpcf/xpcf.h>
+#include "core/Log.h"
+#include "api/pipeline/IMapUpdatePipeline.h"
+#include "api/display/I3DPointsViewer.h"
+
+using namespace SolAR;
+using namespace SolAR::api;
+using namespace SolAR::datastructure;
+namespace xpcf=org::bcom::xpcf;
+
+/* This sample is to test a read-only replica of the map update pipeline.
+*  The replica serves the global map published by the map update pipeline of SolARPipelineTest_MapUpdate (writer),
+*  which can be started before or after this sample. The global map is displayed each time a new version is published.
+*/
+
+int main(int argc, char ** argv)
+{
+#if NDEBUG
+    boost::log::core::get()->set_logging_enabled(false);
+#endif
+
+	LOG_ADD_LOG_TO_CONSOLE();
+
+	try {
+        SRef<xpcf::IComponentManager> xpcfComponentManager = xpcf::getComponentManagerInstance();
+		std::string configxml = std::string("SolARPipelineTest_MapUpdate_Replica_conf.xml");
+		if (argc == 2)
+			configxml = std::string(argv[1]);
+		if (xpcfComponentManager->load(configxml.c_str()) != org::bcom::xpcf::_SUCCESS) {
+			LOG_ERROR("Failed to load the configuration file {}", configxml.c_str());
+			return -1;
+		}
+		// Load components of the map update replica
+		LOG_INFO("Start creating components");
+        auto gMapUpdatePipeline = xpcfComponentManager->resolve<pipeline::IMapUpdatePipeline>();
+		auto gViewer3D = xpcfComponentManager->resolve<display::I3DPointsViewer>();
+		LOG_INFO("All components loaded");
+
+		// Init map update replica
+        if (gMapUpdatePipeline->init() != FrameworkReturnCode::_SUCCESS)
+		{
+			LOG_ERROR("Cannot init map update replica");
+			return -1;
+		}
+
+		// Start pipeline
+		if (gMapUpdatePipeline->start() != FrameworkReturnCode::_SUCCESS) {
+			LOG_ERROR("Cannot start map update replica");
+			return -1;
+		}
+
+		// A replica is read-only
+		if (gMapUpdatePipeline->mapUpdateRequest(xpcf::utils::make_shared<Map>()) == FrameworkReturnCode::_SUCCESS) {
+			LOG_ERROR("Map update request accepted by a replica");
+			return -1;
+		}
+
+		// get data for visualization
+		auto getDataForVisualization = [](const SRef<Map>& map, std::vector<SRef<CloudPoint>> &pointCloud,
+			std::vector<Transform3Df> &keyframesPoses) {
+			pointCloud.clear();
+			keyframesPoses.clear();
+			std::vector<SRef<Keyframe>> keyframes;
+			map->getConstKeyframeCollection()->getAllKeyframes(keyframes);
+			map->getConstPointCloud()->getAllPoints(pointCloud);
+			for (const auto& it : keyframes)
+				keyframesPoses.push_back(it->getPose());
+		};
+
+		// display the global map served by the replica, updated when the writer publishes a new version
+		SRef<Map> displayedMap;
+		std::vector<SRef<CloudPoint>> globalPointCloud;
+		std::vector<Transform3Df> globalKeyframesPoses;
+		while (true) {
+			SRef<Map> globalMap;
+			if ((gMapUpdatePipeline->getMapRequest(globalMap) == FrameworkReturnCode::_SUCCESS) && (globalMap != displayedMap)) {
+				displayedMap = globalMap;
+				getDataForVisualization(displayedMap, globalPointCloud, globalKeyframesPoses);
+				LOG_INFO("New global map version including {} cloudpoints and {} keyframes", globalPointCloud.size(), globalKeyframesPoses.size());
+			}
+			if (gViewer3D->display(globalPointCloud, {}, {}, {}, {}, globalKeyframesPoses) == FrameworkReturnCode::_STOP)
+				break;
+		}
+		LOG_INFO("The global map has {} cloudpoints and {} keyframes.", globalPointCloud.size(), globalKeyframesPoses.size());
+        // Stop pipeline
+		gMapUpdatePipeline->stop();
+	}
+	catch (xpcf::InjectableNotFoundException e)
+	{
+		LOG_ERROR("The following exception in relation to a unfound injectable has been catched: {}", e.what());
+		return -1;
+	}
+	catch (xpcf::Exception e)
+	{
+		LOG_ERROR("The following exception has been catched: {}", e.what());
+		return -1;
+	}
+
+    return 0;
+}